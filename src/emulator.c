@@ -60,39 +60,52 @@
 
 #include "emulator.h"
 #include "mystring.h"
+#include "image.h"
+#include "metrics.h"
+#include "optimise.h"
+#include "pipeline.h"
+#include "scheduler.h"
 
 // Function pointer definition for opcodes
-typedef int (*opcode_function)(char*, char*, char*);
+typedef int (*opcode_function)(const char*, const char*, const char*);
 
-// Contains the program after reading it from the file
-char prog[MAX_PROG_LEN][MAX_LINE_LEN];
-// The length of the loaded program in lines
-int progLen = 0;
+// Contains the program after reading and decoding it from the file
+prog_image* progImage = NULL;
 
 // Used to detect if a program is stuck in an infinite loop
-unsigned int programRuns = 0;
+_Thread_local unsigned int programRuns = 0;
+// The number of values the program has printed so far
+_Thread_local unsigned int outCursor = 0;
+// If set, printed values are stored here instead (there can be no more of
+// them than `MAX_RUNS`)
+_Thread_local unsigned int* outBuf = NULL;
+// The number of instructions left in the current time slice (0 if the
+// program is not being run by the scheduler)
+_Thread_local unsigned int quantum = 0;
 
 // The three general purpose registers
-unsigned int REGA = 0;
-unsigned int REGB = 0;
-unsigned int REGC = 0;
+_Thread_local unsigned int REGA = 0;
+_Thread_local unsigned int REGB = 0;
+_Thread_local unsigned int REGC = 0;
 // A special register, used by JMP
-unsigned int REGX = 0;
+_Thread_local unsigned int REGX = 0;
 // A special register; the instruction pointer pointing to the next
 // program line to be executed
-unsigned int INSP = 0;
+_Thread_local unsigned int INSP = 0;
 
-// Arrays to allow generic access to registers (not actually used in the end)
+// Arrays to allow generic access to registers (used by the optimiser)
 const char* register_str[] = {"REGA", "REGB", "REGC", "REGX"};
 //int *register_ptr[]={&REGA, &REGB, &REGC, &REGX};
 
 
-// Arrays to allow generic access to functions for opcode execution
+// Arrays to allow generic access to functions for opcode execution (the
+// internal opcodes come after the first `MAX_OPCODE`, so that they can never
+// be decoded from a program file)
 const char* opcodeStr[] = {"NOP", "SET", "AND", "OR", "ADD",
-                            "SUB", "SHL", "SHR", "JMP", "PRT"};
+                            "SUB", "SHL", "SHR", "JMP", "PRT", "BRA"};
 opcode_function opcodeFunc[] = {&opcodeNOP, &opcodeSET, &opcodeAND, &opcodeOR,
                                  &opcodeADD, &opcodeSUB, &opcodeSHL, &opcodeSHR,
-                                 &opcodeJMP, &opcodePRT};
+                                 &opcodeJMP, &opcodePRT, &opcodeBRA};
 
 /**
  * A function to handle the `NOP` opcode
@@ -104,7 +117,7 @@ opcode_function opcodeFunc[] = {&opcodeNOP, &opcodeSET, &opcodeAND, &opcodeOR,
  * @param arg2 the second argument (not applicable for `NOP`)
  * @return 0 on success
  */
-int opcodeNOP(char* opcode, char* arg1, char* arg2) {
+int opcodeNOP(const char* opcode, const char* arg1, const char* arg2) {
 	INSP++;
 
    return 0;
@@ -121,7 +134,7 @@ int opcodeNOP(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeSET(char* opcode, char* arg1, char* arg2) {
+int opcodeSET(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = val;
@@ -145,7 +158,7 @@ int opcodeSET(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeAND(char* opcode, char* arg1, char* arg2) {
+int opcodeAND(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA & val;
@@ -169,7 +182,7 @@ int opcodeAND(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeOR(char* opcode, char* arg1, char* arg2) {
+int opcodeOR(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA | val;
@@ -193,7 +206,7 @@ int opcodeOR(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeADD(char* opcode, char* arg1, char* arg2) {
+int opcodeADD(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA + val;
@@ -217,7 +230,7 @@ int opcodeADD(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeSUB(char* opcode, char* arg1, char* arg2) {
+int opcodeSUB(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA - val;
@@ -241,7 +254,7 @@ int opcodeSUB(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeSHL(char* opcode, char* arg1, char* arg2) {
+int opcodeSHL(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA << val;
@@ -265,7 +278,7 @@ int opcodeSHL(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument
  * @return 0 on success
  */
-int opcodeSHR(char* opcode, char* arg1, char* arg2) {
+int opcodeSHR(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg2);
    
    if (!mystrncmp(arg1, "REGA", ARG_LENGTH)) REGA = REGA >> val;
@@ -288,7 +301,7 @@ int opcodeSHR(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the second argument (not applicable for `JMP`)
  * @return 0 on success
  */
-int opcodeJMP(char* opcode, char* arg1, char* arg2) {
+int opcodeJMP(const char* opcode, const char* arg1, const char* arg2) {
    int val = getArg2(arg1);
    
    if (REGX == 0) INSP = val;
@@ -301,25 +314,50 @@ int opcodeJMP(char* opcode, char* arg1, char* arg2) {
  * A function to handle the `PRT` opcode
  * 
  * Prints the value in the register indicated in `arg1`, or the integer value
- * specified.
+ * specified. If `outBuf` is set, the value is stored there instead.
  * 
  * @param opcode the opcode
  * @param arg1 the first argument
  * @param arg2 the second argument (not applicable for `PRT`)
  * @return 0 on success
  */
-int opcodePRT(char* opcode, char* arg1, char* arg2) {
+int opcodePRT(const char* opcode, const char* arg1, const char* arg2) {
+   if (outBuf != NULL) {
+      outBuf[outCursor++] = getArg2(arg1);
+      INSP++;
+      return 0;
+   }
+   
 	if(!mystrncmp(arg1, "REGA", ARG_LENGTH)) printf("REGA = %d\n", REGA);
 	else if(!mystrncmp(arg1, "REGB", ARG_LENGTH)) printf("REGB = %d\n", REGB);
 	else if(!mystrncmp(arg1, "REGC", ARG_LENGTH)) printf("REGC = %d\n", REGC);
 	else if(!mystrncmp(arg1, "REGX", ARG_LENGTH)) printf("REGX = %d\n", REGX);
 	else printf("     = %d\n", atoi(arg1));
    
+   outCursor++;
 	INSP++;
    
 	return 0;
 }
 
+/**
+ * A function to handle the internal `BRA` opcode
+ * 
+ * Jumps to the line indicated by `arg1`, whatever `REGX` contains. `BRA`
+ * can't be written in a program; the optimiser puts it in place of `JMP`s
+ * that it knows will always be taken.
+ * 
+ * @param opcode the opcode
+ * @param arg1 the first argument
+ * @param arg2 the second argument (not applicable for `BRA`)
+ * @return 0 on success
+ */
+int opcodeBRA(const char* opcode, const char* arg1, const char* arg2) {
+   INSP = getArg2(arg1);
+   
+	return 0;
+}
+
 /**
  * A function to return the value in the second argument of an instruction.
  * 
@@ -331,7 +369,7 @@ int opcodePRT(char* opcode, char* arg1, char* arg2) {
  * @param arg2 the value to parse
  * @return an integer
  */
-int getArg2(char* arg2) {   
+int getArg2(const char* arg2) {   
    if (!mystrncmp(arg2, "REGA", ARG_LENGTH)) return REGA;
    else if (!mystrncmp(arg2, "REGB", ARG_LENGTH)) return REGB;
    else if (!mystrncmp(arg2, "REGC", ARG_LENGTH)) return REGC;
@@ -349,7 +387,7 @@ int getArg2(char* arg2) {
  * @param arg2 the second argument (not applicable for `PRT`)
  * @return `true` if the string is valid, `false` if it is not
  */
-bool isValid(char* opcode, char* arg1, char* arg2) { 
+bool isValid(const char* opcode, const char* arg1, const char* arg2) { 
    bool validOpcode = false, validArg1 = false, validArg2 = false;
    
    for (size_t i = 0; (i < MAX_OPCODE) && (!validOpcode); i++)
@@ -363,7 +401,7 @@ bool isValid(char* opcode, char* arg1, char* arg2) {
           (!mystrncmp(arg1, "REGX", ARG_LENGTH)) ||
           (atoi(arg1) > 0)) validArg1 = true;
       
-      if ((mystrncmp(opcode, "JMP", OPCODE_LENGTH)) ||
+      if ((mystrncmp(opcode, "JMP", OPCODE_LENGTH)) &&
           (mystrncmp(opcode, "PRT", OPCODE_LENGTH))) {
          if ((!mystrncmp(arg2, "REGA", ARG_LENGTH)) || 
             (!mystrncmp(arg2, "REGB", ARG_LENGTH)) ||
@@ -377,59 +415,100 @@ bool isValid(char* opcode, char* arg1, char* arg2) {
 }
 
 /**
- * Executes an instruction.
+ * Decodes an instruction.
  * 
- * Tests the validity of an instruction (and whether or not it's a comment), 
- * and if the line passes, calls the appropriate function.
+ * Splits a program line into its opcode and args, tests its validity (and
+ * whether or not it's a comment) and looks up the function that handles it,
+ * so that none of this has to be done again each time the line is run.
  * 
- * @param instruction the instruction to test
- * @return 0 on success, -1 on failure
+ * @param instruction the program line to decode
+ * @param out the decoded instruction
  */
-int execInstruction(char* instruction) {
-// DEBUGGING: prints the current instruction
-//printf("executing line: %s", instruction);
-
+void decodeInstruction(const char* instruction, decoded_instr* out) {
+   size_t i = 0;
+   int instrSection = OPCODE;
+   bool tooLong = false;
+   
+   out->op = INVALID_OP;
+   for (i = 0; i <= OPCODE_LENGTH; i++) out->opcode[i] = '\0';
+   for (i = 0; i <= ARG_LENGTH; i++) out->arg1[i] = out->arg2[i] = '\0';
+   
    // Skips the line if it begins with the comment symbol '#'
-   if (instruction[0] != '#') {
-      // Three arrays to hold the parsed sections of the instruction
-      char opcode[OPCODE_LENGTH];
-      char arg1[ARG_LENGTH];
-      char arg2[ARG_LENGTH];
-      size_t i = 0;
-      int instrSection = OPCODE;
+   if (instruction[0] == '#') {
+      out->op = COMMENT_OP;
+      return;
+   }
+   
+   // Reads the instruction to the end, parsing out the opcode and,
+   // where applicable, arg(s)
+   // Note: I am thick for not using fscanf() and saving 18 lines
+   // (I should probably stop looking at so many SO code golfs)
+   // Stops at the line ending, and rejects any section that would overrun
+   // its array rather than cutting it short and changing its meaning
+   i = 0;
+   while ((*instruction != '\0') && (*instruction != '\n') &&
+          (*instruction != '\r')) {
+      if (*instruction == ' ') {
+         instrSection++;
+         i = 0;
+         instruction++;
+         continue;
+      }
       
-      // Reads the instruction to the end, parsing out the opcode and,
-      // where applicable, arg(s)
-      // Note: I am thick for not using fscanf() and saving 18 lines
-      // (I should probably stop looking at so many SO code golfs)
-      while (*instruction != '\0') {
-         if (*instruction == ' ') {
-            instrSection++;
-            i = 0;
-            instruction++;
-         }
-         
-         switch (instrSection) {
-         case OPCODE:
-            opcode[i++] = *instruction++;
-            break;
-         case ARG1:
-            arg1[i++] = *instruction++;
-            break;
-         case ARG2:
-            arg2[i++] = *instruction++;
-         }
+      switch (instrSection) {
+      case OPCODE:
+         if (i < OPCODE_LENGTH) out->opcode[i++] = *instruction;
+         else tooLong = true;
+         break;
+      case ARG1:
+         if (i < ARG_LENGTH) out->arg1[i++] = *instruction;
+         else tooLong = true;
+         break;
+      case ARG2:
+         if (i < ARG_LENGTH) out->arg2[i++] = *instruction;
+         else tooLong = true;
       }
-      if (isValid(opcode, arg1, arg2)) {
-         // Calls the appropriate function for the instruction
-         for (size_t j = 0; j < MAX_OPCODE; j++)
-            if (!mystrncmp(opcode, opcodeStr[j], OPCODE_LENGTH))
-               (*opcodeFunc[j])(opcode, arg1, arg2);
-      } else return -1;
-   } else INSP++;
+      instruction++;
+   }
+   
+   if ((!tooLong) && (isValid(out->opcode, out->arg1, out->arg2))) {
+      // Finds the appropriate function for the instruction
+      for (size_t j = 0; j < MAX_OPCODE; j++)
+         if (!mystrncmp(out->opcode, opcodeStr[j], OPCODE_LENGTH))
+            out->op = j;
+   }
+}
+
+/**
+ * Executes an instruction.
+ * 
+ * Calls the appropriate function for a decoded instruction, or fails if
+ * the line did not pass validation when it was decoded.
+ * 
+ * @param instr the instruction to execute
+ * @return 0 on success, 1 if the time slice has run out, -1 on failure
+ */
+int execInstruction(const decoded_instr* instr) {
+// DEBUGGING: prints the current instruction
+//printf("executing line: %s %s %s\n", instr->opcode, instr->arg1, instr->arg2);
+
+   if (instr->op == INVALID_OP) {
+      METRIC_COUNT(invalid);
+      return -1;
+   } else if (instr->op == COMMENT_OP) INSP++;
+   else (*opcodeFunc[instr->op])(instr->opcode, instr->arg1, instr->arg2);
+   
+   // Comments are counted first, then each opcode in turn
+   METRIC_COUNT(retired[instr->op + 1]);
    
    programRuns++;
-   if (programRuns > 150) return -1;
+   if (programRuns > MAX_RUNS) {
+      METRIC_COUNT(budgetKills);
+      return -1;
+   }
+   
+   // Hands control back to the scheduler once the time slice is used up
+   if ((quantum > 0) && (--quantum == 0)) return 1;
    
 	return 0;
 }
@@ -442,40 +521,174 @@ int execInstruction(char* instruction) {
  * @return 0 on success, -1 on failure
  */
 int execProgram() {
+   uint64_t start = metricsNow();
+   uint64_t ns;
+   
+   // Checking the optimiser may have run the program on this thread already
+   REGA = 0;
+   REGB = 0;
+   REGC = 0;
+   REGX = 0;
    INSP = 0;
+   programRuns = 0;
+   outCursor = 0;
    printf("RUNNING PROGRAM...\n");
-   while (INSP < progLen) {
-      if (execInstruction(&prog[INSP][0]) < 0) {
-         printf("EXECUTION ERROR\n");
+   while (INSP < progImage->len) {
+      const decoded_instr* instr = &progImage->lines[INSP];
+      
+      if (execInstruction(instr) < 0) {
+         ns = metricsNow() - start;
+         metricsRun(ns, false);
+         metricsPhase(PHASE_EXEC, ns);
+         printf("EXECUTION ERROR (LINE %d)\n", instr->srcLine + 1);
          return -1;
       }
 // DEBUGGING: displays register contents
 //printf("REGS: %d %d %d %d %d\n", REGA, REGB, REGC, REGX, INSP);
    }
+   ns = metricsNow() - start;
+   metricsRun(ns, true);
+   metricsPhase(PHASE_EXEC, ns);
    printf("... DONE!\n");
    return 0;
 }
 
+// The machines being run by `execMachines()`, so that they can be numbered
+context* machines_ptr = NULL;
+
+/**
+ * Reports a machine finishing.
+ * 
+ * @param c the machine
+ */
+void reportMachine(const context* c) {
+   printf("MACHINE %ld %s\n", (long)(c - machines_ptr),
+          (c->state == FAILED) ? "FAILED" : "DONE");
+}
+
+/**
+ * Executes the program on several machines at once.
+ * 
+ * Gives each machine its own set of registers and time-slices them all on
+ * this thread using the scheduler, so that no one machine can hog it.
+ * 
+ * Machine `i` is given priority `i % (MAX_PRIORITY + 1)` if the priorities
+ * are spread. Held machines (the last `held` of them) start out suspended,
+ * and are only resumed once all the others have finished.
+ * 
+ * @param machines the number of machines to run
+ * @param slice the number of instructions each machine runs per turn
+ * @param spread `true` to spread the machines across the priorities
+ * @param held the number of machines to hold back
+ * @param verbose `true` to report each machine as it finishes
+ * @return 0 on success, -1 on failure
+ */
+int execMachines(unsigned int machines, unsigned int slice, bool spread,
+                 unsigned int held, bool verbose) {
+   scheduler s;
+   context* ctx = aligned_alloc(CACHE_LINE, machines * sizeof(context));
+   int failed = 0;
+   uint64_t start;
+   
+   if (ctx == NULL) {
+      printf("OUT OF MEMORY\n");
+      return -1;
+   }
+   if (held > machines) held = machines;
+   
+   schedInit(&s, slice);
+   if (verbose) {
+      machines_ptr = ctx;
+      s.finished = &reportMachine;
+   }
+   for (size_t i = 0; i < machines; i++) {
+      schedInitContext(&ctx[i], progImage,
+                       spread ? (int)(i % (MAX_PRIORITY + 1)) : 0);
+      schedAdd(&s, &ctx[i]);
+      if (i >= machines - held) schedSuspend(&ctx[i]);
+   }
+   
+   printf("RUNNING PROGRAM ON %u MACHINES...\n", machines);
+   start = metricsNow();
+   schedRun(&s);
+   for (size_t i = machines - held; i < machines; i++)
+      schedResume(&s, &ctx[i]);
+   schedRun(&s);
+   metricsPhase(PHASE_EXEC, metricsNow() - start);
+   for (size_t i = 0; i < machines; i++)
+      if (ctx[i].state == FAILED) failed++;
+   free(ctx);
+   
+   if (failed > 0) {
+      printf("EXECUTION ERROR ON %d MACHINES\n", failed);
+      return -1;
+   }
+   printf("... DONE!\n");
+   return 0;
+}
+
+/**
+ * Optimises the loaded program.
+ * 
+ * If asked to, checks that the optimised program gives the same result as
+ * the original (starting with every register at 0) before switching to it.
+ * 
+ * @param passes the optimiser passes to run (see `optimise.h`)
+ * @param verify `true` to check the optimised program
+ * @return 0 on success, -1 on failure
+ */
+int optimiseProgram(int passes, bool verify) {
+   prog_image* opt = optimise(progImage, passes);
+   record init = {0};
+   record result = {0};
+   
+   if (opt == NULL) {
+      printf("OUT OF MEMORY\n");
+      return -1;
+   }
+   
+   if (verify) {
+      runRecord(opt, &result, false);
+      if (!optimiseCheck(progImage, &init, &result)) {
+         printf("VERIFY ERROR\n");
+         imageRelease(opt);
+         return -1;
+      }
+   }
+   
+   imageRelease(progImage);
+   progImage = opt;
+   return 0;
+}
+
 /**
  * Loads a program.
  * 
- * Loads the program file and reads each line into an array.
+ * Loads the program file, reads each line into an array and decodes it into
+ * an image that every run of the program can share.
  * 
+ * @param path the program file
  * @return 0 on success, -1 on failure
  */
-int loadProgram() {
+int loadProgram(const char* path) {
    FILE *f;
+   char prog[MAX_PROG_LEN][MAX_LINE_LEN];
+   int progLen = 0;
+   uint64_t start = metricsNow();
        
    // Reads in the program file (the .scc filetype is just for kicks;
    // the program just reads text files)
-   f = fopen("../programs/prog.scc", "r");
+   f = fopen(path, "r");
    if (f == NULL) {
       printf("FILE OPEN ERROR\n");
       return -1;
    }
-   while(fgets(&prog[progLen][0], MAX_LINE_LEN, f) != NULL) {
+   while((progLen < MAX_PROG_LEN) &&
+         (fgets(&prog[progLen][0], MAX_LINE_LEN, f) != NULL)) {
       progLen++;
    }
+   fclose(f);
+   metricsPhase(PHASE_LOAD, metricsNow() - start);
 
 // DEBUGGING: print the program out
 /* 
@@ -485,17 +698,105 @@ for (int j = 0; j < progLen; j++) {
 }
 */
 
+   start = metricsNow();
+   progImage = imageDecode(prog, progLen);
+   metricsPhase(PHASE_DECODE, metricsNow() - start);
+   if (progImage == NULL) {
+      printf("OUT OF MEMORY\n");
+      return -1;
+   }
+
    return 0;
 }
 
 /**
  * Runs the program.
  * 
+ * `-f <file>` runs a program other than `../programs/prog.scc`.
+ * 
+ * `-n <machines>` runs that many copies of the program side by side under
+ * the scheduler, and `-q <instructions>` sets the length of their time slice.
+ * `-P` spreads the machines across the priorities, `-s <machines>` holds
+ * that many back until the rest have finished, and `-v` reports each
+ * machine as it finishes.
+ * 
+ * `-p <file>` runs the program once for each record of initial register
+ * values in the file (`-` for stdin), across `-t <threads>` threads. The
+ * records are CSV unless `-b` is given, in which case they are binary.
+ * 
+ * `-O <passes>` optimises the program first, running each pass named: `c`
+ * (constant propagation), `b` (known branches), `t` (jump threading) and/or
+ * `d` (dead code removal). `-V` checks the optimised program against the
+ * original, on each record when running a pipeline.
+ * 
+ * `-m <file>` writes runtime metrics to a file (kept up to date while a
+ * pipeline runs), and `-M <port>` serves them over HTTP on localhost.
+ * 
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
  * @return 0 on success, -1 on failure
  */
-int main() {
-   if (loadProgram() < 0) return -1;
-   if (execProgram() < 0) return -1;
+int main(int argc, char* argv[]) {
+   unsigned int machines = 0;
+   unsigned int slice = DEFAULT_QUANTUM;
+   unsigned int threads = 0;
+   const char* path = "../programs/prog.scc";
+   const char* records = NULL;
+   int port = 0;
+   int passes = 0;
+   bool verify = false;
+   bool binary = false;
+   bool spread = false;
+   bool verbose = false;
+   unsigned int held = 0;
+   int status;
    
-   return 0;
+   for (int i = 1; i < argc; i++) {
+      if ((!mystrcmp(argv[i], "-f")) && (i + 1 < argc))
+         path = argv[++i];
+      else if ((!mystrcmp(argv[i], "-n")) && (i + 1 < argc))
+         machines = atoi(argv[++i]);
+      else if ((!mystrcmp(argv[i], "-q")) && (i + 1 < argc))
+         slice = atoi(argv[++i]);
+      else if (!mystrcmp(argv[i], "-P"))
+         spread = true;
+      else if ((!mystrcmp(argv[i], "-s")) && (i + 1 < argc))
+         held = atoi(argv[++i]);
+      else if (!mystrcmp(argv[i], "-v"))
+         verbose = true;
+      else if ((!mystrcmp(argv[i], "-p")) && (i + 1 < argc))
+         records = argv[++i];
+      else if ((!mystrcmp(argv[i], "-t")) && (i + 1 < argc))
+         threads = atoi(argv[++i]);
+      else if (!mystrcmp(argv[i], "-b"))
+         binary = true;
+      else if ((!mystrcmp(argv[i], "-m")) && (i + 1 < argc))
+         metricsExportFile(argv[++i]);
+      else if ((!mystrcmp(argv[i], "-M")) && (i + 1 < argc))
+         port = atoi(argv[++i]);
+      else if ((!mystrcmp(argv[i], "-O")) && (i + 1 < argc)) {
+         if ((passes = optimisePasses(argv[++i])) < 0) {
+            printf("UNKNOWN OPTIMISER PASS\n");
+            return -1;
+         }
+      } else if (!mystrcmp(argv[i], "-V"))
+         verify = true;
+   }
+   
+   metricsAttach();
+   if ((port > 0) && (metricsServe(port) < 0)) return -1;
+   if (loadProgram(path) < 0) return -1;
+   if ((records == NULL) && (passes != 0) &&
+       (optimiseProgram(passes, verify) < 0)) return -1;
+   
+   if (records != NULL)
+      status = execPipeline(progImage, records, binary, threads, passes,
+                            verify);
+   else if (machines > 0)
+      status = execMachines(machines, slice, spread, held, verbose);
+   else status = execProgram();
+   imageRelease(progImage);
+   metricsUpdate(true);
+   
+   return (status < 0) ? -1 : 0;
 }
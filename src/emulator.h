@@ -33,34 +33,66 @@
 #define MAX_PROG_LEN 99 // The maximum length (in lines) a program can have
 #define MAX_LINE_LEN 80 // The maximum length of a program line (in characters)
 #define MAX_OPCODE   10 // The maximum number of opcodes that are supported
+#define OPCODE_BRA   10 // The internal opcode the optimiser uses for `BRA`
+#define MAX_OPCODE_INTERNAL 11 // The number of opcodes, internal ones included
 #define MAX_REGISTER 4  // The maximum number of registers (minus INSP)
 #define OPCODE_LENGTH 3 // The maximum length of an opcode
 #define ARG_LENGTH 4    // The maximum length of an arg
+#define MAX_RUNS 150    // The maximum number of instructions a program can run
 #define OPCODE 0        // Used for parsing instruction segments
 #define ARG1 1
 #define ARG2 2
+#define COMMENT_OP -1   // Decoded opcode of a comment line
+#define INVALID_OP -2   // Decoded opcode of a line that failed validation
+
+// A program line, parsed and validated ahead of time
+typedef struct {
+   signed char op; // index into the opcode arrays, or one of the above
+   unsigned char srcLine; // the line of the program file it came from
+   char opcode[OPCODE_LENGTH + 1];
+   char arg1[ARG_LENGTH + 1];
+   char arg2[ARG_LENGTH + 1];
+} decoded_instr;
+
+// Emulator state, shared with the scheduler and pipeline. Each thread has
+// its own, so that several programs can be run at once
+extern _Thread_local unsigned int programRuns;
+extern _Thread_local unsigned int outCursor;
+extern _Thread_local unsigned int* outBuf;
+extern _Thread_local unsigned int quantum;
+extern _Thread_local unsigned int REGA, REGB, REGC, REGX, INSP;
+
+// The opcode and register names, as used by the validator, the optimiser
+// and the metrics
+extern const char* opcodeStr[];
+extern const char* register_str[];
 
 // Opcode handling functions
-int opcodeNOP(char* opcode, char* arg1, char* arg2);
-int opcodeSET(char* opcode, char* arg1, char* arg2);
-int opcodeAND(char* opcode, char* arg1, char* arg2);
-int opcodeOR(char* opcode, char* arg1, char* arg2);
-int opcodeADD(char* opcode, char* arg1, char* arg2);
-int opcodeSUB(char* opcode, char* arg1, char* arg2);
-int opcodeSHL(char* opcode, char* arg1, char* arg2);
-int opcodeSHR(char* opcode, char* arg1, char* arg2);
-int opcodeJMP(char* opcode, char* arg1, char* arg2);
-int opcodePRT(char* opcode, char* arg1, char* arg2);
+int opcodeNOP(const char* opcode, const char* arg1, const char* arg2);
+int opcodeSET(const char* opcode, const char* arg1, const char* arg2);
+int opcodeAND(const char* opcode, const char* arg1, const char* arg2);
+int opcodeOR(const char* opcode, const char* arg1, const char* arg2);
+int opcodeADD(const char* opcode, const char* arg1, const char* arg2);
+int opcodeSUB(const char* opcode, const char* arg1, const char* arg2);
+int opcodeSHL(const char* opcode, const char* arg1, const char* arg2);
+int opcodeSHR(const char* opcode, const char* arg1, const char* arg2);
+int opcodeJMP(const char* opcode, const char* arg1, const char* arg2);
+int opcodePRT(const char* opcode, const char* arg1, const char* arg2);
+int opcodeBRA(const char* opcode, const char* arg1, const char* arg2);
 
 // Argument extraction function
-int getArg2(char* arg2);
+int getArg2(const char* arg2);
 
-// Command validator function
-bool isValid(char* opcode, char* arg1, char* arg2);
+// Command validator and decoder functions
+bool isValid(const char* opcode, const char* arg1, const char* arg2);
+void decodeInstruction(const char* instruction, decoded_instr* out);
 
 // Emulator run functions
-int execInstruction(char* instruction);
+int execInstruction(const decoded_instr* instr);
 int execProgram();
-int loadProgram();
+int execMachines(unsigned int machines, unsigned int slice, bool spread,
+                 unsigned int held, bool verbose);
+int optimiseProgram(int passes, bool verify);
+int loadProgram(const char* path);
 
 #endif /* EMULATOR_H_ */
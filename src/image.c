@@ -0,0 +1,123 @@
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Functions for decoding a program into a shareable, reference-counted
+ * image.
+ */
+
+#include <stdlib.h> // used for malloc() and free()
+
+#include "image.h"
+#include "mystring.h"
+
+/**
+ * Decodes a program.
+ * 
+ * Runs `decodeInstruction()` on each line of the program in turn. The image
+ * starts out with one reference, held by the caller.
+ * 
+ * @param prog the program text, one line per row
+ * @param progLen the length of the program in lines
+ * @return the image on success, `NULL` if it could not be allocated
+ */
+prog_image* imageDecode(char prog[][MAX_LINE_LEN], int progLen) {
+   prog_image* img = malloc(sizeof(prog_image) +
+                            progLen * sizeof(decoded_instr));
+   
+   if (img == NULL) return NULL;
+   
+   atomic_init(&img->refs, 1);
+   img->len = progLen;
+   for (int i = 0; i < progLen; i++) {
+      decodeInstruction(&prog[i][0], &img->lines[i]);
+      img->lines[i].srcLine = i;
+   }
+   
+   return img;
+}
+
+/**
+ * Makes a copy of an image that leaves the general purpose registers alone.
+ * 
+ * Programs usually begin by `SET`ting their inputs. This copy turns each
+ * `SET` of a constant into `REGA`, `REGB` or `REGC` at the start of the
+ * program (before anything other than a comment or `SET`) into a `NOP`, so
+ * that the program can be run on inputs loaded into the registers
+ * beforehand. Lines are not removed, so `JMP`s still land in the same place.
+ * 
+ * @param img the image to copy
+ * @return the copy on success, `NULL` if it could not be allocated
+ */
+prog_image* imageSkipInit(const prog_image* img) {
+   size_t size = sizeof(prog_image) + img->len * sizeof(decoded_instr);
+   prog_image* copy = malloc(size);
+   decoded_instr nop;
+   
+   if (copy == NULL) return NULL;
+   
+   atomic_init(&copy->refs, 1);
+   copy->len = img->len;
+   decodeInstruction("NOP", &nop);
+   for (int i = 0; i < img->len; i++) copy->lines[i] = img->lines[i];
+   
+   for (int i = 0; i < copy->len; i++) {
+      decoded_instr* line = &copy->lines[i];
+      
+      if (line->op == COMMENT_OP) continue;
+      if ((line->op < 0) || (mystrncmp(line->opcode, "SET", OPCODE_LENGTH)))
+         break;
+      
+      if (((!mystrncmp(line->arg1, "REGA", ARG_LENGTH)) ||
+           (!mystrncmp(line->arg1, "REGB", ARG_LENGTH)) ||
+           (!mystrncmp(line->arg1, "REGC", ARG_LENGTH))) &&
+          (mystrncmp(line->arg2, "REG", 3))) {
+         nop.srcLine = line->srcLine;
+         *line = nop;
+      }
+   }
+   
+   return copy;
+}
+
+/**
+ * Takes another reference to an image.
+ * 
+ * @param img the image
+ * @return `img`, for convenience
+ */
+prog_image* imageRetain(prog_image* img) {
+   atomic_fetch_add_explicit(&img->refs, 1, memory_order_relaxed);
+   
+   return img;
+}
+
+/**
+ * Lets go of a reference to an image, freeing it if it was the last one.
+ * 
+ * @param img the image (`NULL` is ignored)
+ */
+void imageRelease(prog_image* img) {
+   if (img == NULL) return;
+   
+   if (atomic_fetch_sub_explicit(&img->refs, 1, memory_order_acq_rel) == 1)
+      free(img);
+}
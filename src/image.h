@@ -0,0 +1,47 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Header file for `image.c`.                                            
+ */
+
+#include <stdatomic.h> // used for atomic_int
+
+#include "emulator.h"
+
+// A decoded program. Programs never modify themselves, so one image is
+// shared read-only by every machine running the program, and freed when
+// the last of them lets go of it
+typedef struct {
+   atomic_int refs;
+   int len;
+   decoded_instr lines[];
+} prog_image;
+
+prog_image* imageDecode(char prog[][MAX_LINE_LEN], int progLen);
+prog_image* imageSkipInit(const prog_image* img);
+prog_image* imageRetain(prog_image* img);
+void imageRelease(prog_image* img);
+
+#endif /* IMAGE_H_ */
@@ -0,0 +1,351 @@
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Runtime counters and their export in the Prometheus text format.
+ * 
+ * Each thread counts into its own `localMetrics`, so recording a metric is a
+ * plain add with no locking or shared cache lines. Threads attach their
+ * counters to a list so that they can be summed up when the metrics are
+ * read, and fold them into a running total when they detach (just before
+ * they exit). Counters of a thread that never attaches are not reported.
+ */
+
+#include <arpa/inet.h> // used for htonl() and htons()
+#include <netinet/in.h> // used for struct sockaddr_in
+#include <pthread.h> // used for pthread_mutex_t and pthread_create()
+#include <signal.h> // used for signal()
+#include <sys/socket.h> // used for socket(), bind(), listen() and accept()
+#include <sys/time.h> // used for struct timeval
+#include <time.h> // used for clock_gettime()
+#include <unistd.h> // used for close()
+
+#include "metrics.h"
+
+#define LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+_Thread_local thread_metrics localMetrics;
+
+// The counters of every attached thread
+static thread_metrics* attached = NULL;
+// The counters of threads that have since detached
+static thread_metrics detached;
+// Guards both of the above
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Where (and when) the metrics were last written to a file
+static const char* exportPath = NULL;
+static uint64_t lastExport = 0;
+
+// Names for the phases, as they appear in the export
+static const char* phaseStr[] = {"load", "decode", "execute"};
+
+/**
+ * Adds one set of counters to another.
+ * 
+ * @param sum the counters to add to
+ * @param t the counters to add
+ */
+static void addMetrics(thread_metrics* sum, thread_metrics* t) {
+   for (size_t i = 0; i < MAX_RETIRED; i++)
+      METRIC_ADD(sum->retired[i], LOAD(t->retired[i]));
+   METRIC_ADD(sum->runs, LOAD(t->runs));
+   METRIC_ADD(sum->budgetKills, LOAD(t->budgetKills));
+   METRIC_ADD(sum->invalid, LOAD(t->invalid));
+   for (size_t i = 0; i < MAX_PHASE; i++)
+      METRIC_ADD(sum->phaseNs[i], LOAD(t->phaseNs[i]));
+   for (size_t i = 0; i <= LATENCY_BUCKETS; i++)
+      METRIC_ADD(sum->latency[i], LOAD(t->latency[i]));
+   METRIC_ADD(sum->latencyNs, LOAD(t->latencyNs));
+}
+
+/**
+ * Sets a set of counters to zero.
+ * 
+ * @param t the counters
+ */
+static void clearMetrics(thread_metrics* t) {
+   for (size_t i = 0; i < MAX_RETIRED; i++)
+      atomic_store_explicit(&t->retired[i], 0, memory_order_relaxed);
+   atomic_store_explicit(&t->runs, 0, memory_order_relaxed);
+   atomic_store_explicit(&t->budgetKills, 0, memory_order_relaxed);
+   atomic_store_explicit(&t->invalid, 0, memory_order_relaxed);
+   for (size_t i = 0; i < MAX_PHASE; i++)
+      atomic_store_explicit(&t->phaseNs[i], 0, memory_order_relaxed);
+   for (size_t i = 0; i <= LATENCY_BUCKETS; i++)
+      atomic_store_explicit(&t->latency[i], 0, memory_order_relaxed);
+   atomic_store_explicit(&t->latencyNs, 0, memory_order_relaxed);
+}
+
+/**
+ * Attaches the current thread's counters, so that they are reported.
+ */
+void metricsAttach() {
+   pthread_mutex_lock(&metricsLock);
+   localMetrics.next = attached;
+   attached = &localMetrics;
+   pthread_mutex_unlock(&metricsLock);
+}
+
+/**
+ * Detaches the current thread's counters, keeping what they have counted.
+ * 
+ * Must be called before an attached thread exits.
+ */
+void metricsDetach() {
+   pthread_mutex_lock(&metricsLock);
+   for (thread_metrics** t = &attached; *t != NULL; t = &(*t)->next) {
+      if (*t == &localMetrics) {
+         *t = localMetrics.next;
+         break;
+      }
+   }
+   addMetrics(&detached, &localMetrics);
+   clearMetrics(&localMetrics);
+   pthread_mutex_unlock(&metricsLock);
+}
+
+/**
+ * Gets the current time.
+ * 
+ * @return the time from an arbitrary fixed point (in ns)
+ */
+uint64_t metricsNow() {
+   struct timespec ts;
+   
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Records a finished run of a program.
+ * 
+ * @param ns how long the run took (in ns)
+ * @param ok `true` if the run succeeded, `false` if not
+ */
+void metricsRun(uint64_t ns, bool ok) {
+   size_t bucket = 0;
+   
+   if (localMetrics.paused) return;
+   for (uint64_t bound = FIRST_BUCKET_NS;
+        (bucket < LATENCY_BUCKETS) && (ns > bound); bound <<= 1)
+      bucket++;
+   
+   if (ok) METRIC_INC(localMetrics.runs);
+   METRIC_INC(localMetrics.latency[bucket]);
+   METRIC_ADD(localMetrics.latencyNs, ns);
+}
+
+/**
+ * Records time spent in a phase.
+ * 
+ * @param p the phase
+ * @param ns the time spent (in ns)
+ */
+void metricsPhase(phase p, uint64_t ns) {
+   if (localMetrics.paused) return;
+   METRIC_ADD(localMetrics.phaseNs[p], ns);
+}
+
+/**
+ * Writes out the metrics of every thread, summed together, in the Prometheus
+ * text format.
+ * 
+ * @param f the file to write to
+ */
+void metricsWrite(FILE* f) {
+   thread_metrics sum;
+   uint64_t count = 0;
+   
+   clearMetrics(&sum);
+   pthread_mutex_lock(&metricsLock);
+   addMetrics(&sum, &detached);
+   for (thread_metrics* t = attached; t != NULL; t = t->next)
+      addMetrics(&sum, t);
+   pthread_mutex_unlock(&metricsLock);
+   
+   fprintf(f, "# HELP emulator_instructions_retired_total "
+              "Instructions executed, by opcode.\n"
+              "# TYPE emulator_instructions_retired_total counter\n");
+   for (size_t i = 0; i < MAX_RETIRED; i++)
+      fprintf(f, "emulator_instructions_retired_total{opcode=\"%s\"} %lu\n",
+              (i == 0) ? "comment" : opcodeStr[i - 1],
+              (unsigned long)LOAD(sum.retired[i]));
+   
+   fprintf(f, "# HELP emulator_runs_completed_total "
+              "Program runs that finished successfully.\n"
+              "# TYPE emulator_runs_completed_total counter\n"
+              "emulator_runs_completed_total %lu\n",
+           (unsigned long)LOAD(sum.runs));
+   fprintf(f, "# HELP emulator_budget_kills_total "
+              "Program runs stopped for running too many instructions.\n"
+              "# TYPE emulator_budget_kills_total counter\n"
+              "emulator_budget_kills_total %lu\n",
+           (unsigned long)LOAD(sum.budgetKills));
+   fprintf(f, "# HELP emulator_validation_failures_total "
+              "Program runs stopped by an invalid instruction.\n"
+              "# TYPE emulator_validation_failures_total counter\n"
+              "emulator_validation_failures_total %lu\n",
+           (unsigned long)LOAD(sum.invalid));
+   
+   fprintf(f, "# HELP emulator_phase_seconds_total "
+              "Time spent loading, decoding and executing programs.\n"
+              "# TYPE emulator_phase_seconds_total counter\n");
+   for (size_t i = 0; i < MAX_PHASE; i++)
+      fprintf(f, "emulator_phase_seconds_total{phase=\"%s\"} %.9f\n",
+              phaseStr[i], LOAD(sum.phaseNs[i]) / 1e9);
+   
+   fprintf(f, "# HELP emulator_run_latency_seconds "
+              "Time from a program run starting to it finishing.\n"
+              "# TYPE emulator_run_latency_seconds histogram\n");
+   for (size_t i = 0; i <= LATENCY_BUCKETS; i++) {
+      count += LOAD(sum.latency[i]);
+      if (i < LATENCY_BUCKETS)
+         fprintf(f, "emulator_run_latency_seconds_bucket{le=\"%g\"} %lu\n",
+                 ((uint64_t)FIRST_BUCKET_NS << i) / 1e9, (unsigned long)count);
+   }
+   fprintf(f, "emulator_run_latency_seconds_bucket{le=\"+Inf\"} %lu\n"
+              "emulator_run_latency_seconds_sum %.9f\n"
+              "emulator_run_latency_seconds_count %lu\n",
+           (unsigned long)count, LOAD(sum.latencyNs) / 1e9,
+           (unsigned long)count);
+}
+
+/**
+ * Sets the file that `metricsUpdate()` writes the metrics to.
+ * 
+ * @param path the file
+ */
+void metricsExportFile(const char* path) {
+   exportPath = path;
+}
+
+/**
+ * Writes the metrics to the export file, if one is set.
+ * 
+ * Does nothing if the file was written less than `METRICS_INTERVAL_NS` ago,
+ * unless forced. The metrics are written to a temporary file first and then
+ * renamed over the old one, so a reader never sees half a file. Should only
+ * be called from one thread.
+ * 
+ * @param force `true` to write the file however recently it was written
+ */
+void metricsUpdate(bool force) {
+   char tmp[FILENAME_MAX];
+   uint64_t now = metricsNow();
+   FILE* f;
+   
+   if (exportPath == NULL) return;
+   if ((!force) && (now - lastExport < METRICS_INTERVAL_NS)) return;
+   lastExport = now;
+   
+   snprintf(tmp, FILENAME_MAX, "%s.tmp", exportPath);
+   f = fopen(tmp, "w");
+   if (f == NULL) {
+      fprintf(stderr, "METRICS FILE ERROR\n");
+      return;
+   }
+   metricsWrite(f);
+   fclose(f);
+   rename(tmp, exportPath);
+}
+
+/**
+ * Answers HTTP requests for the metrics.
+ * 
+ * Every request gets the metrics, whatever path it asks for. Clients are
+ * served one at a time, so each one is given `METRICS_TIMEOUT_S` to send its
+ * request and take the response, rather than being able to hold up the
+ * rest forever.
+ * 
+ * @param arg the listening socket
+ * @return `NULL` (never returns)
+ */
+static void* serveMetrics(void* arg) {
+   int server = *(int*)arg;
+   char request[1024];
+   struct timeval timeout = {METRICS_TIMEOUT_S, 0};
+   
+   free(arg);
+   for (;;) {
+      int client = accept(server, NULL, NULL);
+      FILE* f;
+      
+      if (client < 0) continue;
+      
+      setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      
+      // The request itself is not needed, but has to be read first
+      if ((recv(client, request, sizeof(request), 0) <= 0) ||
+          ((f = fdopen(client, "w")) == NULL)) {
+         close(client);
+         continue;
+      }
+      fprintf(f, "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Connection: close\r\n\r\n");
+      metricsWrite(f);
+      fclose(f);
+   }
+   
+   return NULL;
+}
+
+/**
+ * Starts serving the metrics over HTTP on the local machine.
+ * 
+ * @param port the port to listen on
+ * @return 0 on success, -1 on failure
+ */
+int metricsServe(int port) {
+   struct sockaddr_in addr = {0};
+   int* server = malloc(sizeof(int));
+   pthread_t tid;
+   
+   if (server == NULL) return -1;
+   
+   // A scraper hanging up mid-response should not kill the emulator
+   signal(SIGPIPE, SIG_IGN);
+   
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = htons(port);
+   
+   *server = socket(AF_INET, SOCK_STREAM, 0);
+   if ((*server < 0) ||
+       (bind(*server, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+       (listen(*server, 8) < 0)) {
+      fprintf(stderr, "METRICS SOCKET ERROR\n");
+      if (*server >= 0) close(*server);
+      free(server);
+      return -1;
+   }
+   
+   if (pthread_create(&tid, NULL, serveMetrics, server) != 0) {
+      close(*server);
+      free(server);
+      return -1;
+   }
+   pthread_detach(tid);
+   
+   return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Header file for `metrics.c`.                                            
+ */
+
+#include <stdatomic.h> // used for atomic counters
+#include <stdint.h> // used for uint64_t
+#include <stdio.h> // used for FILE
+
+#include "emulator.h"
+
+#define LATENCY_BUCKETS 16 // The number of run latency histogram buckets
+#define FIRST_BUCKET_NS 1000 // The upper bound of the first bucket (in ns)
+#define MAX_RETIRED (MAX_OPCODE_INTERNAL + 1) // Retire counts (comments first)
+#define METRICS_INTERVAL_NS 1000000000 // The minimum time between file writes
+#define METRICS_TIMEOUT_S 1 // How long a scraper gets to send or take data
+
+// Bumps a counter. Only the owning thread writes to its counters, so a
+// relaxed load and store (a plain add) is enough; the atomics are only there
+// so that other threads can read them safely
+#define METRIC_ADD(counter, n) \
+   atomic_store_explicit(&(counter), \
+      atomic_load_explicit(&(counter), memory_order_relaxed) + (n), \
+      memory_order_relaxed)
+#define METRIC_INC(counter) METRIC_ADD(counter, 1)
+
+// Bumps one of the current thread's counters, unless counting is paused
+#define METRIC_COUNT(counter) \
+   do { if (!localMetrics.paused) METRIC_INC(localMetrics.counter); } while (0)
+
+// The phases of running a program that are timed
+typedef enum { PHASE_LOAD, PHASE_DECODE, PHASE_EXEC, MAX_PHASE } phase;
+
+// One thread's counters
+typedef struct thread_metrics {
+   _Atomic uint64_t retired[MAX_RETIRED];
+   _Atomic uint64_t runs;
+   _Atomic uint64_t budgetKills;
+   _Atomic uint64_t invalid;
+   _Atomic uint64_t phaseNs[MAX_PHASE];
+   _Atomic uint64_t latency[LATENCY_BUCKETS + 1];
+   _Atomic uint64_t latencyNs;
+   bool paused; // set while running programs only to check the optimiser
+   struct thread_metrics* next;
+} thread_metrics;
+
+// The counters of the current thread
+extern _Thread_local thread_metrics localMetrics;
+
+// Thread registration functions
+void metricsAttach();
+void metricsDetach();
+
+// Recording functions
+uint64_t metricsNow();
+void metricsRun(uint64_t ns, bool ok);
+void metricsPhase(phase p, uint64_t ns);
+
+// Export functions
+void metricsWrite(FILE* f);
+void metricsExportFile(const char* path);
+void metricsUpdate(bool force);
+int metricsServe(int port);
+
+#endif /* METRICS_H_ */
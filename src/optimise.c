@@ -0,0 +1,665 @@
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * An optimiser for decoded programs.
+ * 
+ * The passes work on a copy of the program that keeps its original line
+ * numbering, so `JMP` targets stay valid throughout; a line that a pass
+ * gets rid of is only marked as removed, and acts like a `NOP` until the
+ * end, when the remaining lines are packed together and the `JMP` targets
+ * renumbered to match. Each line keeps its `srcLine`, so errors can still be
+ * reported against the program file.
+ * 
+ * The optimised program does the same thing as the original, but in fewer
+ * instructions, so it can finish within `MAX_RUNS` where the original would
+ * have been stopped. A `JMP` to a register could land anywhere, so programs
+ * with one are left alone.
+ */
+
+#include <stdlib.h> // used for malloc() and atoi()
+
+#include "optimise.h"
+#include "mystring.h"
+
+// What is known about the registers on reaching a line
+typedef struct {
+   bool reached;
+   bool known[MAX_REGISTER];
+   unsigned int val[MAX_REGISTER];
+} reg_state;
+
+// A program being optimised
+typedef struct {
+   int len;
+   decoded_instr lines[MAX_PROG_LEN];
+   int target[MAX_PROG_LEN]; // the line a `JMP` or `BRA` goes to
+   bool removed[MAX_PROG_LEN];
+} ir_prog;
+
+/**
+ * Finds which register an arg names.
+ * 
+ * @param arg the arg
+ * @return the index of the register, or -1 if it isn't one
+ */
+static int regIndex(const char* arg) {
+   for (int i = 0; i < MAX_REGISTER; i++)
+      if (!mystrncmp(arg, register_str[i], ARG_LENGTH)) return i;
+   
+   return -1;
+}
+
+/**
+ * Tests if a line is a (conditional) `JMP`.
+ * 
+ * @param l the line
+ * @return `true` if it is, `false` if not
+ */
+static bool isJmp(const decoded_instr* l) {
+   return (l->op >= 0) && (!mystrncmp(l->opcode, "JMP", OPCODE_LENGTH));
+}
+
+/**
+ * Tests if a line is an unconditional `BRA`.
+ * 
+ * @param l the line
+ * @return `true` if it is, `false` if not
+ */
+static bool isBra(const decoded_instr* l) {
+   return l->op == OPCODE_BRA;
+}
+
+/**
+ * Tests if a line does nothing but move on to the next one.
+ * 
+ * @param p the program
+ * @param i the line number
+ * @return `true` if it does, `false` if not
+ */
+static bool isNoOp(const ir_prog* p, int i) {
+   return (p->removed[i]) || (p->lines[i].op == COMMENT_OP) ||
+          ((p->lines[i].op >= 0) &&
+           (!mystrncmp(p->lines[i].opcode, "NOP", OPCODE_LENGTH)));
+}
+
+/**
+ * Finds the register a line writes to.
+ * 
+ * @param l the line
+ * @return the index of the register, or -1 if it doesn't write to one
+ */
+static int destReg(const decoded_instr* l) {
+   if ((l->op < 0) || (l->op >= MAX_OPCODE) ||
+       (!mystrncmp(l->opcode, "NOP", OPCODE_LENGTH)) ||
+       (!mystrncmp(l->opcode, "JMP", OPCODE_LENGTH)) ||
+       (!mystrncmp(l->opcode, "PRT", OPCODE_LENGTH)))
+      return -1;
+   
+   return regIndex(l->arg1);
+}
+
+/**
+ * Finds the registers a line reads.
+ * 
+ * @param l the line
+ * @param uses set to `true` for each register read
+ */
+static void usedRegs(const decoded_instr* l, bool uses[MAX_REGISTER]) {
+   int r;
+   
+   for (int i = 0; i < MAX_REGISTER; i++) uses[i] = false;
+   if (l->op < 0) return;
+   
+   if (isJmp(l)) uses[regIndex("REGX")] = true;
+   if ((isJmp(l)) || (isBra(l)) ||
+       (!mystrncmp(l->opcode, "PRT", OPCODE_LENGTH))) {
+      if ((r = regIndex(l->arg1)) >= 0) uses[r] = true;
+   } else if (destReg(l) >= 0) {
+      if (mystrncmp(l->opcode, "SET", OPCODE_LENGTH))
+         uses[destReg(l)] = true;
+      if ((r = regIndex(l->arg2)) >= 0) uses[r] = true;
+   }
+}
+
+/**
+ * Finds the lines that can run after a line.
+ * 
+ * @param p the program
+ * @param i the line number
+ * @param succ the lines that can run next (`p->len` for the end)
+ * @return the number of lines found
+ */
+static int successors(const ir_prog* p, int i, int succ[2]) {
+   const decoded_instr* l = &p->lines[i];
+   int n = 0;
+   
+   if (isNoOp(p, i)) {
+      succ[n++] = i + 1;
+   } else if (l->op == INVALID_OP) {
+      return 0;
+   } else if (isBra(l)) {
+      succ[n++] = p->target[i];
+   } else {
+      succ[n++] = i + 1;
+      if (isJmp(l)) succ[n++] = p->target[i];
+   }
+   
+   return n;
+}
+
+/**
+ * Works out the value a line puts in its register, if it can be known.
+ * 
+ * @param l the line
+ * @param st what is known about the registers before the line
+ * @param out the value
+ * @return `true` if the value is known, `false` if not
+ */
+static bool evalLine(const decoded_instr* l, const reg_state* st,
+                     unsigned int* out) {
+   int dest = destReg(l);
+   int src = regIndex(l->arg2);
+   unsigned int a, v;
+   
+   if (dest < 0) return false;
+   if ((src >= 0) && (!st->known[src])) return false;
+   v = (src >= 0) ? st->val[src] : (unsigned int)atoi(l->arg2);
+   
+   if (!mystrncmp(l->opcode, "SET", OPCODE_LENGTH)) {
+      *out = v;
+      return true;
+   }
+   if (!st->known[dest]) return false;
+   a = st->val[dest];
+   
+   if (!mystrncmp(l->opcode, "AND", OPCODE_LENGTH)) *out = a & v;
+   else if (!mystrncmp(l->opcode, "OR", OPCODE_LENGTH)) *out = a | v;
+   else if (!mystrncmp(l->opcode, "ADD", OPCODE_LENGTH)) *out = a + v;
+   else if (!mystrncmp(l->opcode, "SUB", OPCODE_LENGTH)) *out = a - v;
+   else if ((!mystrncmp(l->opcode, "SHL", OPCODE_LENGTH)) && (v < 32))
+      *out = a << v;
+   else if ((!mystrncmp(l->opcode, "SHR", OPCODE_LENGTH)) && (v < 32))
+      *out = a >> v;
+   else return false;
+   
+   return true;
+}
+
+/**
+ * Merges what is known about the registers along one path into a line.
+ * 
+ * @param dst what is known on reaching the line
+ * @param src what is known along the path
+ * @return `true` if `dst` changed, `false` if not
+ */
+static bool mergeState(reg_state* dst, const reg_state* src) {
+   bool changed = false;
+   
+   if (!dst->reached) {
+      *dst = *src;
+      return true;
+   }
+   
+   for (int i = 0; i < MAX_REGISTER; i++) {
+      if ((dst->known[i]) &&
+          ((!src->known[i]) || (src->val[i] != dst->val[i]))) {
+         dst->known[i] = false;
+         changed = true;
+      }
+   }
+   
+   return changed;
+}
+
+/**
+ * Works out which registers hold a known value on reaching each line.
+ * 
+ * Nothing is assumed about the registers at the start of the program. A
+ * `JMP` is only ever taken when `REGX` is 0, so that is known at its target.
+ * 
+ * @param p the program
+ * @param in what is known on reaching each line
+ */
+static void analyseConsts(const ir_prog* p, reg_state in[]) {
+   bool changed = true;
+   
+   for (int i = 0; i < p->len; i++) in[i].reached = false;
+   if (p->len == 0) return;
+   in[0].reached = true;
+   for (int r = 0; r < MAX_REGISTER; r++) in[0].known[r] = false;
+   
+   while (changed) {
+      changed = false;
+      for (int i = 0; i < p->len; i++) {
+         reg_state out = in[i];
+         unsigned int val;
+         int succ[2];
+         int n, dest;
+         
+         if (!in[i].reached) continue;
+         
+         if ((!p->removed[i]) && ((dest = destReg(&p->lines[i])) >= 0)) {
+            out.known[dest] = evalLine(&p->lines[i], &in[i], &val);
+            out.val[dest] = val;
+         }
+         
+         n = successors(p, i, succ);
+         for (int s = 0; s < n; s++) {
+            reg_state edge = out;
+            
+            if (succ[s] >= p->len) continue;
+            if ((!isNoOp(p, i)) && (isJmp(&p->lines[i])) && (s == 1)) {
+               edge.known[regIndex("REGX")] = true;
+               edge.val[regIndex("REGX")] = 0;
+            }
+            if (mergeState(&in[succ[s]], &edge)) changed = true;
+         }
+      }
+   }
+}
+
+/**
+ * Rewrites a line.
+ * 
+ * @param l the line
+ * @param op the index of the new opcode
+ * @param arg1 the new first argument
+ * @param arg2 the new second argument
+ */
+static void setLine(decoded_instr* l, int op, const char* arg1,
+                    const char* arg2) {
+   unsigned char srcLine = l->srcLine;
+   const char* parts[] = {opcodeStr[op], arg1, arg2};
+   char* dest[] = {l->opcode, l->arg1, l->arg2};
+   size_t lens[] = {OPCODE_LENGTH, ARG_LENGTH, ARG_LENGTH};
+   
+   for (size_t p = 0; p < 3; p++) {
+      size_t i = 0;
+      for (; (i < lens[p]) && (parts[p][i] != '\0'); i++)
+         dest[p][i] = parts[p][i];
+      for (; i <= lens[p]; i++) dest[p][i] = '\0';
+   }
+   l->op = op;
+   l->srcLine = srcLine;
+}
+
+/**
+ * Constant propagation.
+ * 
+ * Turns each line whose result is known into a `SET` of that result, and
+ * replaces each register read as `arg2` with its value where that is known.
+ * 
+ * @param p the program
+ */
+static void passConstProp(ir_prog* p) {
+   reg_state in[MAX_PROG_LEN];
+   char buf[ARG_LENGTH + 1];
+   
+   analyseConsts(p, in);
+   for (int i = 0; i < p->len; i++) {
+      decoded_instr* l = &p->lines[i];
+      int dest = destReg(l);
+      int src = regIndex(l->arg2);
+      unsigned int val;
+      
+      if ((p->removed[i]) || (!in[i].reached) || (dest < 0)) continue;
+      
+      if ((evalLine(l, &in[i], &val)) && (val <= MAX_CONST)) {
+         snprintf(buf, sizeof(buf), "%u", val);
+         setLine(l, 1, register_str[dest], buf);
+      } else if ((src >= 0) && (in[i].known[src]) &&
+                 (in[i].val[src] <= MAX_CONST)) {
+         snprintf(buf, sizeof(buf), "%u", in[i].val[src]);
+         setLine(l, l->op, l->arg1, buf);
+      }
+   }
+}
+
+/**
+ * Known branches.
+ * 
+ * Turns each `JMP` that is always taken into a `BRA`, and removes each one
+ * that never is.
+ * 
+ * @param p the program
+ */
+static void passBranch(ir_prog* p) {
+   reg_state in[MAX_PROG_LEN];
+   int x = regIndex("REGX");
+   
+   analyseConsts(p, in);
+   for (int i = 0; i < p->len; i++) {
+      if ((isNoOp(p, i)) || (!isJmp(&p->lines[i])) || (!in[i].reached) ||
+          (!in[i].known[x]))
+         continue;
+      
+      if (in[i].val[x] == 0)
+         setLine(&p->lines[i], OPCODE_BRA, p->lines[i].arg1, "");
+      else p->removed[i] = true;
+   }
+}
+
+/**
+ * Follows a jump to where it really ends up.
+ * 
+ * Skips over lines that do nothing, and through `BRA`s. A `JMP` that has
+ * just been taken leaves `REGX` at 0, so it also goes through the `JMP`s
+ * it lands on.
+ * 
+ * @param p the program
+ * @param t the line jumped to
+ * @param taken `true` if `REGX` is known to be 0
+ * @return the line it ends up on
+ */
+static int resolveTarget(const ir_prog* p, int t, bool taken) {
+   int start = t;
+   
+   for (int steps = 0; t < p->len; steps++) {
+      // A loop made only of jumps and lines that do nothing
+      if (steps > p->len) return start;
+      
+      if (isNoOp(p, t)) t++;
+      else if ((isBra(&p->lines[t])) ||
+               ((taken) && (isJmp(&p->lines[t])))) t = p->target[t];
+      else break;
+   }
+   
+   return (t < p->len) ? t : p->len;
+}
+
+/**
+ * Jump threading.
+ * 
+ * Points each jump straight at where it ends up, rather than at a chain of
+ * jumps.
+ * 
+ * @param p the program
+ */
+static void passThread(ir_prog* p) {
+   for (int i = 0; i < p->len; i++) {
+      if (isNoOp(p, i)) continue;
+      
+      if (isJmp(&p->lines[i]))
+         p->target[i] = resolveTarget(p, p->target[i], true);
+      else if (isBra(&p->lines[i]))
+         p->target[i] = resolveTarget(p, p->target[i], false);
+   }
+}
+
+/**
+ * Finds the next line, at or after the one given, that hasn't been removed.
+ * 
+ * @param p the program
+ * @param i the line number
+ * @return the line number (`p->len` for the end)
+ */
+static int nextLive(const ir_prog* p, int i) {
+   while ((i < p->len) && (p->removed[i])) i++;
+   
+   return (i < p->len) ? i : p->len;
+}
+
+/**
+ * Removes the lines no run of the program can reach.
+ * 
+ * @param p the program
+ * @return `true` if anything was removed, `false` if not
+ */
+static bool removeUnreachable(ir_prog* p) {
+   bool reached[MAX_PROG_LEN] = {false};
+   int stack[MAX_PROG_LEN];
+   int top = 0;
+   bool changed = false;
+   
+   if (p->len > 0) {
+      reached[0] = true;
+      stack[top++] = 0;
+   }
+   while (top > 0) {
+      int succ[2];
+      int i = stack[--top];
+      int n = successors(p, i, succ);
+      
+      for (int s = 0; s < n; s++) {
+         if ((succ[s] < p->len) && (!reached[succ[s]])) {
+            reached[succ[s]] = true;
+            stack[top++] = succ[s];
+         }
+      }
+   }
+   
+   for (int i = 0; i < p->len; i++) {
+      if ((!reached[i]) && (!p->removed[i])) {
+         p->removed[i] = true;
+         changed = true;
+      }
+   }
+   
+   return changed;
+}
+
+/**
+ * Removes the lines that write to a register nothing reads again.
+ * 
+ * Every register counts as read at the end of the program, since its final
+ * value can be seen, and when an invalid line stops it.
+ * 
+ * @param p the program
+ * @return `true` if anything was removed, `false` if not
+ */
+static bool removeDeadStores(ir_prog* p) {
+   bool liveOut[MAX_PROG_LEN][MAX_REGISTER];
+   bool liveIn[MAX_PROG_LEN + 1][MAX_REGISTER];
+   bool changed = true;
+   bool removed = false;
+   
+   for (int i = 0; i <= p->len; i++)
+      for (int r = 0; r < MAX_REGISTER; r++)
+         liveIn[i][r] = (i == p->len);
+   
+   while (changed) {
+      changed = false;
+      for (int i = p->len - 1; i >= 0; i--) {
+         bool uses[MAX_REGISTER] = {false};
+         int succ[2];
+         int n = successors(p, i, succ);
+         int dest = isNoOp(p, i) ? -1 : destReg(&p->lines[i]);
+         
+         if (!isNoOp(p, i)) usedRegs(&p->lines[i], uses);
+         for (int r = 0; r < MAX_REGISTER; r++) {
+            bool live = (n == 0);
+            bool in;
+            
+            for (int s = 0; s < n; s++)
+               if (liveIn[(succ[s] < p->len) ? succ[s] : p->len][r])
+                  live = true;
+            liveOut[i][r] = live;
+            
+            in = (uses[r]) || ((live) && (r != dest));
+            if (in != liveIn[i][r]) {
+               liveIn[i][r] = in;
+               changed = true;
+            }
+         }
+      }
+   }
+   
+   for (int i = 0; i < p->len; i++) {
+      int dest = isNoOp(p, i) ? -1 : destReg(&p->lines[i]);
+      
+      if ((dest >= 0) && (!liveOut[i][dest])) {
+         p->removed[i] = true;
+         removed = true;
+      }
+   }
+   
+   return removed;
+}
+
+/**
+ * Dead code removal.
+ * 
+ * Removes comments, `NOP`s, jumps to the next line, lines that can't be
+ * reached and lines whose result is never used, until there are none left.
+ * 
+ * @param p the program
+ */
+static void passDCE(ir_prog* p) {
+   bool changed = true;
+   
+   while (changed) {
+      changed = false;
+      for (int i = 0; i < p->len; i++) {
+         if (p->removed[i]) continue;
+         // Removing a line can leave an earlier jump pointing at the next one
+         if ((isNoOp(p, i)) ||
+             (((isJmp(&p->lines[i])) || (isBra(&p->lines[i]))) &&
+              (nextLive(p, p->target[i]) == nextLive(p, i + 1)))) {
+            p->removed[i] = true;
+            changed = true;
+         }
+      }
+      
+      if (removeUnreachable(p)) changed = true;
+      if (removeDeadStores(p)) changed = true;
+   }
+}
+
+/**
+ * Turns a string of pass letters into the passes to run.
+ * 
+ * @param s the letters: `c`, `b`, `t` and/or `d`
+ * @return the passes, or -1 if there is a letter that isn't a pass
+ */
+int optimisePasses(const char* s) {
+   const char* letters = "cbtd";
+   int passes = 0;
+   
+   for (; *s != '\0'; s++) {
+      char* found = mystrchr((char*)letters, *s);
+      
+      if (found == NULL) return -1;
+      passes |= 1 << (found - letters);
+   }
+   
+   return passes;
+}
+
+/**
+ * Optimises a program.
+ * 
+ * Runs the passes asked for in the order constant propagation, known
+ * branches, jump threading and then dead code removal, so that each can
+ * make use of what the ones before it did.
+ * 
+ * @param img the program
+ * @param passes the passes to run (`OPT_` flags or'd together)
+ * @return the optimised program (with one reference, held by the caller),
+ *         or `NULL` if it could not be allocated
+ */
+prog_image* optimise(prog_image* img, int passes) {
+   ir_prog* p;
+   prog_image* opt;
+   int map[MAX_PROG_LEN + 1];
+   int len = 0;
+   
+   if (img->len > MAX_PROG_LEN) return imageRetain(img);
+   for (int i = 0; i < img->len; i++)
+      if ((isJmp(&img->lines[i])) && (regIndex(img->lines[i].arg1) >= 0))
+         return imageRetain(img);
+   
+   p = malloc(sizeof(ir_prog));
+   if (p == NULL) return NULL;
+   
+   p->len = img->len;
+   for (int i = 0; i < p->len; i++) {
+      p->lines[i] = img->lines[i];
+      p->removed[i] = false;
+      p->target[i] = isJmp(&p->lines[i]) ? atoi(p->lines[i].arg1) : -1;
+      if (p->target[i] > p->len) p->target[i] = p->len;
+   }
+   
+   if (passes & OPT_CONSTPROP) passConstProp(p);
+   if (passes & OPT_BRANCH) passBranch(p);
+   if (passes & OPT_THREAD) passThread(p);
+   if (passes & OPT_DCE) passDCE(p);
+   
+   // Packs the remaining lines together, and renumbers the jumps to match
+   for (int i = 0; i < p->len; i++)
+      if (!p->removed[i]) len++;
+   map[p->len] = len;
+   for (int i = p->len - 1; i >= 0; i--)
+      map[i] = p->removed[i] ? map[i + 1] : --len;
+   
+   opt = malloc(sizeof(prog_image) + map[p->len] * sizeof(decoded_instr));
+   if (opt == NULL) {
+      free(p);
+      return NULL;
+   }
+   atomic_init(&opt->refs, 1);
+   opt->len = map[p->len];
+   
+   for (int i = 0; i < p->len; i++) {
+      decoded_instr* l = &opt->lines[map[i]];
+      
+      if (p->removed[i]) continue;
+      
+      *l = p->lines[i];
+      if ((isJmp(l)) || (isBra(l)))
+         snprintf(l->arg1, ARG_LENGTH + 1, "%d", map[p->target[i]]);
+   }
+   
+   free(p);
+   return opt;
+}
+
+/**
+ * Checks a run of an optimised program against the original.
+ * 
+ * Runs the original program from the same registers, and compares the final
+ * registers and printed values. A run the original was stopped for taking
+ * too long isn't checked, as the optimised program may finish it in fewer
+ * instructions; a run that stopped on an invalid line must stop on it in the
+ * optimised program too.
+ * 
+ * @param ref the original program
+ * @param init the registers the run started with
+ * @param result the result of the run
+ * @return `true` if the results match (or can't be checked), `false` if not
+ */
+bool optimiseCheck(const prog_image* ref, const record* init,
+                   const record* result) {
+   record expected = *init;
+   
+   runRecord(ref, &expected, false);
+   if (expected.status == RUN_TOO_LONG) return true;
+   
+   if ((result->status != expected.status) ||
+       (result->REGA != expected.REGA) || (result->REGB != expected.REGB) ||
+       (result->REGC != expected.REGC) || (result->REGX != expected.REGX) ||
+       (result->outLen != expected.outLen))
+      return false;
+   for (size_t i = 0; i < expected.outLen; i++)
+      if (result->out[i] != expected.out[i]) return false;
+   
+   return true;
+}
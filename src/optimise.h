@@ -0,0 +1,47 @@
+#ifndef OPTIMISE_H_
+#define OPTIMISE_H_
+
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Header file for `optimise.c`.                                            
+ */
+
+#include <stdbool.h> // used for bool data type
+
+#include "emulator.h"
+#include "image.h"
+#include "pipeline.h"
+
+#define OPT_CONSTPROP 1 // Constant propagation and folding (`c`)
+#define OPT_BRANCH 2    // Known `JMP`s to `BRA`s or fall-throughs (`b`)
+#define OPT_THREAD 4    // Jump threading (`t`)
+#define OPT_DCE 8       // Dead and unreachable line removal (`d`)
+#define MAX_CONST 9999  // The largest constant that fits in an arg
+
+// Optimiser functions
+int optimisePasses(const char* s);
+prog_image* optimise(prog_image* img, int passes);
+bool optimiseCheck(const prog_image* ref, const record* init,
+                   const record* result);
+
+#endif /* OPTIMISE_H_ */
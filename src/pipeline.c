@@ -0,0 +1,463 @@
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Runs one program over a stream of initial register values.
+ * 
+ * Each record gives the values of `REGA`, `REGB` and `REGC` to start a run
+ * with, either as a line of CSV (`4,610,0`) or in binary as three 32-bit
+ * little-endian unsigned integers. The records are read a batch at a time,
+ * the batch is split across a pool of threads (started once, and kept for
+ * the whole stream), and the results are written to stdout
+ * in the same order as the records came in, one line of CSV per record:
+ * 
+ * `<record>,<OK|ERROR|MISMATCH>,<REGA>,<REGB>,<REGC>,<REGX>[,<printed value>...]`
+ * 
+ * Only one batch is held in memory at a time, however long the input is.
+ */
+
+#include <errno.h> // used for errno and ERANGE
+#include <limits.h> // used for UINT_MAX
+#include <pthread.h> // used for threads, mutexes and condition variables
+#include <unistd.h> // used for sysconf()
+
+#include "pipeline.h"
+#include "metrics.h"
+#include "mystring.h"
+#include "optimise.h"
+
+// The records one thread is given to run (and, if verifying, the original
+// program to check them against)
+typedef struct {
+   const prog_image* img;
+   const prog_image* ref;
+   record* recs;
+   size_t count;
+   struct worker_pool* pool;
+} batch_slice;
+
+// The threads that share out each batch with the main thread. Slice 0 is
+// always run by the main thread; worker `i` runs slice `i + 1`
+typedef struct worker_pool {
+   pthread_mutex_t lock;
+   pthread_cond_t start; // signalled when there is a new batch
+   pthread_cond_t done;  // signalled when the last worker finishes it
+   unsigned long batch;  // the number of batches handed out so far
+   unsigned int pending; // the number of workers still on this batch
+   unsigned int workers;
+   bool stop;
+   pthread_t tid[MAX_THREADS];
+   batch_slice slices[MAX_THREADS];
+} worker_pool;
+
+/**
+ * Reads a line, and checks that it fitted in the buffer.
+ * 
+ * @param f the file to read from
+ * @param line the buffer, `MAX_RECORD_LEN` characters long
+ * @return 1 on success, 0 at the end of the file, -1 if the line is too long
+ */
+static int readLine(FILE* f, char* line) {
+   int c;
+   
+   if (fgets(line, MAX_RECORD_LEN, f) == NULL) return 0;
+   if ((mystrchr(line, '\n') != NULL) ||
+       (mystrlen(line) < MAX_RECORD_LEN - 1))
+      return 1;
+   
+   // The buffer filled up before the end of the line; that's only fine if
+   // it was the last line of the file
+   if ((c = getc(f)) == EOF) return 1;
+   ungetc(c, f);
+   
+   return -1;
+}
+
+/**
+ * Reads a record in CSV format.
+ * 
+ * Blank lines and lines beginning with the comment symbol '#' are skipped.
+ * Each value must be an unsigned integer that fits in a register.
+ * 
+ * @param f the file to read from
+ * @param r the record to fill in
+ * @return 1 on success, 0 at the end of the file, -1 if the record is invalid
+ */
+static int readCSV(FILE* f, record* r) {
+   char line[MAX_RECORD_LEN];
+   unsigned int* regs[] = {&r->REGA, &r->REGB, &r->REGC};
+   int got;
+   
+   for (;;) {
+      if ((got = readLine(f, line)) == 0) return 0;
+      if ((line[0] != '#') && (line[0] != '\n') && (line[0] != '\r')) break;
+      
+      // Throws away the rest of a comment too long for the buffer
+      while (got < 0) {
+         int c = getc(f);
+         if ((c == '\n') || (c == EOF)) break;
+      }
+   }
+   if (got < 0) return -1;
+   
+   char* field = line;
+   for (size_t i = 0; i < 3; i++) {
+      char* end;
+      unsigned long val;
+      
+      while (*field == ' ') field++;
+      if ((*field < '0') || (*field > '9')) return -1;
+      
+      errno = 0;
+      val = strtoul(field, &end, 10);
+      if ((errno == ERANGE) || (val > UINT_MAX)) return -1;
+      *regs[i] = val;
+      while (*end == ' ') end++;
+      
+      if (i < 2) {
+         if (*end != ',') return -1;
+         field = end + 1;
+      } else if ((*end != '\0') && (*end != '\n') && (*end != '\r'))
+         return -1;
+   }
+   
+   return 1;
+}
+
+/**
+ * Reads a record in binary format.
+ * 
+ * @param f the file to read from
+ * @param r the record to fill in
+ * @return 1 on success, 0 at the end of the file, -1 if the record is cut off
+ */
+static int readBinary(FILE* f, record* r) {
+   unsigned char buf[RECORD_SIZE];
+   unsigned int* regs[] = {&r->REGA, &r->REGB, &r->REGC};
+   size_t got = fread(buf, 1, RECORD_SIZE, f);
+   
+   if (got == 0) return 0;
+   if (got < RECORD_SIZE) return -1;
+   
+   for (size_t i = 0; i < 3; i++)
+      *regs[i] = (unsigned int)buf[i * 4] |
+                 ((unsigned int)buf[i * 4 + 1] << 8) |
+                 ((unsigned int)buf[i * 4 + 2] << 16) |
+                 ((unsigned int)buf[i * 4 + 3] << 24);
+   
+   return 1;
+}
+
+/**
+ * Runs the program on one record.
+ * 
+ * Loads the record's values into this thread's registers and runs the
+ * program to the end, collecting anything it prints.
+ * 
+ * @param img the program to run
+ * @param r the record
+ * @param counted whether the run goes into the metrics
+ */
+void runRecord(const prog_image* img, record* r, bool counted) {
+   int status = 0;
+   bool paused = localMetrics.paused;
+   
+   localMetrics.paused = !counted;
+   REGA = r->REGA;
+   REGB = r->REGB;
+   REGC = r->REGC;
+   REGX = 0;
+   INSP = 0;
+   programRuns = 0;
+   outCursor = 0;
+   outBuf = r->out;
+   
+   while ((INSP < img->len) &&
+          ((status = execInstruction(&img->lines[INSP])) >= 0));
+   
+   outBuf = NULL;
+   r->REGA = REGA;
+   r->REGB = REGB;
+   r->REGC = REGC;
+   r->REGX = REGX;
+   r->outLen = outCursor;
+   if (status >= 0) r->status = 0;
+   else r->status = (programRuns > MAX_RUNS) ? RUN_TOO_LONG : RUN_FAILED;
+   localMetrics.paused = paused;
+}
+
+/**
+ * Runs the program on each record in a slice of a batch.
+ * 
+ * The clock is only read once per record: each record's run is timed from
+ * the end of the one before it.
+ * 
+ * @param arg the slice
+ * @return `NULL`
+ */
+static void* runSlice(void* arg) {
+   batch_slice* slice = arg;
+   uint64_t first, last;
+   
+   if (slice->count == 0) return NULL;
+   
+   first = last = metricsNow();
+   for (size_t i = 0; i < slice->count; i++) {
+      record init;
+      uint64_t now;
+      
+      if (slice->ref != NULL) init = slice->recs[i];
+      runRecord(slice->img, &slice->recs[i], true);
+      now = metricsNow();
+      metricsRun(now - last, slice->recs[i].status >= 0);
+      last = now;
+      
+      if (slice->ref != NULL) {
+         if (!optimiseCheck(slice->ref, &init, &slice->recs[i]))
+            slice->recs[i].status = VERIFY_FAILED;
+         // Keeps the check out of the next record's time
+         last = metricsNow();
+      }
+   }
+   metricsPhase(PHASE_EXEC, last - first);
+   
+   return NULL;
+}
+
+/**
+ * Runs slices of batches for the pool, until told to stop.
+ * 
+ * @param arg the worker's slice
+ * @return `NULL`
+ */
+static void* worker(void* arg) {
+   batch_slice* slice = arg;
+   worker_pool* pool = slice->pool;
+   unsigned long seen = 0;
+   
+   metricsAttach();
+   pthread_mutex_lock(&pool->lock);
+   for (;;) {
+      while ((pool->batch == seen) && (!pool->stop))
+         pthread_cond_wait(&pool->start, &pool->lock);
+      if (pool->stop) break;
+      seen = pool->batch;
+      
+      pthread_mutex_unlock(&pool->lock);
+      runSlice(slice);
+      pthread_mutex_lock(&pool->lock);
+      
+      if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+   }
+   pthread_mutex_unlock(&pool->lock);
+   metricsDetach();
+   
+   return NULL;
+}
+
+/**
+ * Starts the worker threads of a pool.
+ * 
+ * If a thread cannot be started, the pool just makes do with fewer.
+ * 
+ * @param pool the pool
+ * @param threads the number of threads to use, the main thread included
+ */
+static void poolStart(worker_pool* pool, unsigned int threads) {
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->start, NULL);
+   pthread_cond_init(&pool->done, NULL);
+   pool->batch = 0;
+   pool->pending = 0;
+   pool->workers = 0;
+   pool->stop = false;
+   
+   for (size_t i = 0; i < MAX_THREADS; i++) {
+      pool->slices[i].pool = pool;
+      pool->slices[i].count = 0;
+   }
+   
+   while (pool->workers + 1 < threads) {
+      if (pthread_create(&pool->tid[pool->workers], NULL, worker,
+                         &pool->slices[pool->workers + 1]) != 0)
+         break;
+      pool->workers++;
+   }
+}
+
+/**
+ * Stops the worker threads of a pool.
+ * 
+ * @param pool the pool
+ */
+static void poolStop(worker_pool* pool) {
+   pthread_mutex_lock(&pool->lock);
+   pool->stop = true;
+   pthread_cond_broadcast(&pool->start);
+   pthread_mutex_unlock(&pool->lock);
+   
+   for (size_t i = 0; i < pool->workers; i++)
+      pthread_join(pool->tid[i], NULL);
+   
+   pthread_cond_destroy(&pool->done);
+   pthread_cond_destroy(&pool->start);
+   pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * Runs the program on each record in a batch.
+ * 
+ * Splits the batch into one slice for this thread and one for each worker,
+ * and waits for the workers to finish theirs.
+ * 
+ * @param pool the pool
+ * @param img the program to run
+ * @param ref the original program to check against (`NULL` if not verifying)
+ * @param recs the batch
+ * @param count the number of records in the batch
+ */
+static void runBatch(worker_pool* pool, const prog_image* img,
+                     const prog_image* ref, record* recs, size_t count) {
+   unsigned int threads = pool->workers + 1;
+   size_t per = (count + threads - 1) / threads;
+   
+   pthread_mutex_lock(&pool->lock);
+   for (size_t i = 0; i < threads; i++) {
+      size_t first = i * per;
+      
+      pool->slices[i].img = img;
+      pool->slices[i].ref = ref;
+      pool->slices[i].recs = &recs[first];
+      pool->slices[i].count = (first >= count) ? 0 :
+                              ((count - first < per) ? count - first : per);
+   }
+   pool->pending = pool->workers;
+   pool->batch++;
+   pthread_cond_broadcast(&pool->start);
+   pthread_mutex_unlock(&pool->lock);
+   
+   runSlice(&pool->slices[0]);
+   
+   pthread_mutex_lock(&pool->lock);
+   while (pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+   pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Writes out the result of a record.
+ * 
+ * @param f the file to write to
+ * @param n the number of the record
+ * @param r the record
+ */
+static void writeRecord(FILE* f, unsigned long n, const record* r) {
+   fprintf(f, "%lu,%s,%u,%u,%u,%u", n,
+           (r->status == VERIFY_FAILED) ? "MISMATCH" :
+           ((r->status < 0) ? "ERROR" : "OK"),
+           r->REGA, r->REGB, r->REGC, r->REGX);
+   for (size_t i = 0; i < r->outLen; i++) fprintf(f, ",%u", r->out[i]);
+   fputc('\n', f);
+}
+
+/**
+ * Runs the program once for each record in a file.
+ * 
+ * The program's own `SET`s of `REGA`, `REGB` and `REGC` at its start are
+ * skipped (see `imageSkipInit()`), so that the values from the records are
+ * used instead. The program is then optimised, if asked to. Errors are
+ * reported on stderr, to keep them out of the results.
+ * 
+ * @param img the program to run
+ * @param path the file of records (`-` for stdin)
+ * @param binary `true` if the records are binary, `false` if they are CSV
+ * @param threads the number of threads to use (0 for one per CPU)
+ * @param passes the optimiser passes to run (see `optimise.h`)
+ * @param verify `true` to check each record against the unoptimised program
+ * @return 0 on success, -1 on failure
+ */
+int execPipeline(prog_image* img, const char* path, bool binary,
+                 unsigned int threads, int passes, bool verify) {
+   FILE* f = (!mystrcmp(path, "-")) ? stdin : fopen(path, binary ? "rb" : "r");
+   record* recs;
+   prog_image* run;
+   prog_image* opt = NULL;
+   worker_pool pool;
+   unsigned long n = 0;
+   int got = 1;
+   int status = 0;
+   
+   if (f == NULL) {
+      fprintf(stderr, "FILE OPEN ERROR\n");
+      return -1;
+   }
+   
+   if (threads == 0) {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = (cpus > 0) ? cpus : 1;
+   }
+   if (threads > MAX_THREADS) threads = MAX_THREADS;
+   
+   recs = malloc(BATCH_SIZE * sizeof(record));
+   run = imageSkipInit(img);
+   if ((run != NULL) && (passes != 0)) opt = optimise(run, passes);
+   if ((recs == NULL) || (run == NULL) || ((passes != 0) && (opt == NULL))) {
+      fprintf(stderr, "OUT OF MEMORY\n");
+      free(recs);
+      imageRelease(run);
+      imageRelease(opt);
+      if (f != stdin) fclose(f);
+      return -1;
+   }
+   
+   poolStart(&pool, threads);
+   while (got > 0) {
+      size_t count = 0;
+      
+      while ((count < BATCH_SIZE) &&
+             ((got = binary ? readBinary(f, &recs[count]) :
+                              readCSV(f, &recs[count])) > 0))
+         count++;
+      
+      if (opt != NULL) runBatch(&pool, opt, verify ? run : NULL, recs, count);
+      else runBatch(&pool, run, NULL, recs, count);
+      for (size_t i = 0; i < count; i++) {
+         if (recs[i].status == VERIFY_FAILED) {
+            fprintf(stderr, "VERIFY ERROR (RECORD %lu)\n", n);
+            status = -1;
+         }
+         writeRecord(stdout, n++, &recs[i]);
+      }
+      metricsUpdate(false);
+      
+      if (got < 0) {
+         fprintf(stderr, "INPUT ERROR (RECORD %lu)\n", n);
+         status = -1;
+      }
+   }
+   poolStop(&pool);
+   
+   free(recs);
+   imageRelease(run);
+   imageRelease(opt);
+   if (f != stdin) fclose(f);
+   
+   return status;
+}
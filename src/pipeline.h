@@ -0,0 +1,60 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Header file for `pipeline.c`.                                            
+ */
+
+#include <stdbool.h> // used for bool data type
+
+#include "emulator.h"
+#include "image.h"
+
+#define BATCH_SIZE 1024 // The number of records read into memory at once
+#define MAX_THREADS 64  // The maximum number of threads a batch is split over
+#define MAX_RECORD_LEN 80 // The maximum length of a CSV record (in characters)
+#define RECORD_SIZE 12  // The size of a binary record (in bytes)
+
+// The status of a record whose run stopped on an invalid line
+#define RUN_FAILED -1
+// The status of a record whose optimised run did not match the original
+#define VERIFY_FAILED -2
+// The status of a record whose run was stopped after `MAX_RUNS` instructions
+#define RUN_TOO_LONG -3
+
+// One run of the program: its initial registers going in, and its final
+// registers and printed values coming out
+typedef struct {
+   unsigned int REGA, REGB, REGC, REGX;
+   int status;
+   unsigned int outLen;
+   unsigned int out[MAX_RUNS + 1];
+} record;
+
+// Pipeline run functions
+void runRecord(const prog_image* img, record* r, bool counted);
+int execPipeline(prog_image* img, const char* path, bool binary,
+                 unsigned int threads, int passes, bool verify);
+
+#endif /* PIPELINE_H_ */
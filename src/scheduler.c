@@ -0,0 +1,196 @@
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * A cooperative scheduler that time-slices many machines on one thread.
+ * 
+ * There is only one set of registers, so each machine keeps a saved copy of
+ * its own; the scheduler swaps a machine's copy in, lets it run for its time
+ * slice (counted by `execInstruction()` alongside `programRuns`) and then
+ * swaps it back out to the end of the queue. Every machine in the queue gets
+ * a turn before any machine gets a second one, so a short program is never
+ * stuck waiting behind a long one. A machine's priority makes its time slice
+ * longer rather than letting it jump the queue, so nothing is ever starved.
+ */
+
+#include <stddef.h> // used for NULL
+
+#include "metrics.h"
+#include "scheduler.h"
+
+/**
+ * Sets up an empty scheduler.
+ * 
+ * @param s the scheduler
+ * @param quantum the number of instructions a priority 0 machine runs per turn
+ */
+void schedInit(scheduler* s, unsigned int quantum) {
+   s->head = NULL;
+   s->tail = NULL;
+   s->quantum = (quantum > 0) ? quantum : DEFAULT_QUANTUM;
+   s->finished = NULL;
+}
+
+/**
+ * Sets up a machine to run a program from the start.
+ * 
+ * The machine takes a reference to the program image, and lets go of it
+ * when the program finishes.
+ * 
+ * @param c the machine
+ * @param img the program to run
+ * @param priority the priority, from 0 to `MAX_PRIORITY`
+ */
+void schedInitContext(context* c, prog_image* img, int priority) {
+   c->REGA = c->REGB = c->REGC = c->REGX = c->INSP = 0;
+   c->programRuns = 0;
+   c->outCursor = 0;
+   c->started = metricsNow();
+   c->img = imageRetain(img);
+   if (priority < 0) priority = 0;
+   if (priority > MAX_PRIORITY) priority = MAX_PRIORITY;
+   c->priority = priority;
+   c->state = READY;
+   c->queued = false;
+   c->next = NULL;
+}
+
+/**
+ * Puts a machine on the end of the run queue.
+ * 
+ * @param s the scheduler
+ * @param c the machine
+ */
+void schedAdd(scheduler* s, context* c) {
+   c->next = NULL;
+   c->queued = true;
+   if (s->tail == NULL) s->head = c;
+   else s->tail->next = c;
+   s->tail = c;
+}
+
+/**
+ * Suspends a machine.
+ * 
+ * The machine is left where it is in the queue and just skipped over when
+ * its turn comes up, so this is cheap however many machines there are.
+ * 
+ * @param c the machine
+ */
+void schedSuspend(context* c) {
+   if (c->state == READY) c->state = SUSPENDED;
+}
+
+/**
+ * Resumes a suspended machine.
+ * 
+ * @param s the scheduler
+ * @param c the machine
+ */
+void schedResume(scheduler* s, context* c) {
+   if (c->state != SUSPENDED) return;
+   
+   c->state = READY;
+   if (!c->queued) schedAdd(s, c);
+}
+
+/**
+ * Swaps a machine's registers in.
+ * 
+ * @param c the machine
+ */
+static void loadContext(const context* c) {
+   REGA = c->REGA;
+   REGB = c->REGB;
+   REGC = c->REGC;
+   REGX = c->REGX;
+   INSP = c->INSP;
+   programRuns = c->programRuns;
+   outCursor = c->outCursor;
+}
+
+/**
+ * Swaps a machine's registers out.
+ * 
+ * @param c the machine
+ */
+static void saveContext(context* c) {
+   c->REGA = REGA;
+   c->REGB = REGB;
+   c->REGC = REGC;
+   c->REGX = REGX;
+   c->INSP = INSP;
+   c->programRuns = programRuns;
+   c->outCursor = outCursor;
+}
+
+/**
+ * Gives the machine at the front of the queue its turn.
+ * 
+ * Runs the machine until its program ends, fails or uses up its time slice,
+ * and in the last case puts it back on the end of the queue. Suspended
+ * machines are taken off the queue without running.
+ * 
+ * @param s the scheduler
+ * @return `true` if there are still machines waiting, `false` if not
+ */
+bool schedStep(scheduler* s) {
+   context* c = s->head;
+   int status = 0;
+   
+   if (c == NULL) return false;
+   
+   s->head = c->next;
+   if (s->head == NULL) s->tail = NULL;
+   c->next = NULL;
+   c->queued = false;
+   
+   if (c->state != READY) return (s->head != NULL);
+   
+   loadContext(c);
+   quantum = s->quantum * (c->priority + 1);
+   while ((INSP < c->img->len) &&
+          ((status = execInstruction(&c->img->lines[INSP])) == 0));
+   quantum = 0;
+   saveContext(c);
+   
+   if ((status >= 0) && (INSP < c->img->len)) {
+      schedAdd(s, c);
+   } else {
+      c->state = (status < 0) ? FAILED : DONE;
+      metricsRun(metricsNow() - c->started, status >= 0);
+      imageRelease(c->img);
+      c->img = NULL;
+      if (s->finished != NULL) s->finished(c);
+   }
+   
+   return (s->head != NULL);
+}
+
+/**
+ * Runs every machine in the queue until they have all finished (or been
+ * suspended).
+ * 
+ * @param s the scheduler
+ */
+void schedRun(scheduler* s) {
+   while (schedStep(s));
+}
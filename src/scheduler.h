@@ -0,0 +1,84 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+/**
+ * @file															                         
+ * @author  Ben Goldsworthy (rumps) <me+scc150@bengoldsworthy.net>		          
+ * @version 1.0	                                                          
+ *                                                                          
+ * @section LICENSE                                                         
+ *                                                                          
+ * This file is free software: you can redistribute it and/or modify        
+ * it under the terms of the GNU General Public License as published by     
+ * the Free Software Foundation, either version 3 of the License,           
+ * or (at your option) any later version.                                   
+ *                                                                          
+ * This file is distributed in the hope that it will be useful,             
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            
+ * GNU General Public License for more details.                             
+ *                                                                          
+ * You should have received a copy of the GNU General Public License        
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    
+ *                                                                          
+ * @section DESCRIPTION                                                     
+ *                                                                          
+ * Header file for `scheduler.c`.                                            
+ */
+
+#include <stdbool.h> // used for bool data type
+#include <stdint.h> // used for uint64_t
+
+#include "emulator.h"
+#include "image.h"
+
+#define MAX_PRIORITY 7     // The highest priority a machine can be given
+#define DEFAULT_QUANTUM 10 // The default time slice (in instructions)
+#define CACHE_LINE 64      // The size of a cache line (in bytes)
+
+// The states a machine can be in
+typedef enum { READY, SUSPENDED, DONE, FAILED } context_state;
+
+// A machine: the saved registers of one run of a program, plus the
+// bookkeeping needed to queue it. The program itself lives in a shared
+// image, so this is all the state a machine has of its own
+typedef struct context {
+   _Alignas(CACHE_LINE) unsigned int REGA;
+   unsigned int REGB, REGC, REGX, INSP;
+   unsigned int programRuns;
+   unsigned int outCursor;
+   uint64_t started;
+   prog_image* img;
+   unsigned char priority;
+   unsigned char state;
+   bool queued;
+   struct context* next;
+} context;
+
+// Keeps a machine to exactly one cache line (as long as it is allocated
+// with `aligned_alloc()`, as `calloc()` only aligns to 16 bytes)
+_Static_assert(sizeof(context) == CACHE_LINE,
+               "context must fill exactly one cache line");
+
+// A round-robin run queue of machines sharing one thread
+typedef struct {
+   context* head;
+   context* tail;
+   unsigned int quantum;
+   void (*finished)(const context* c); // called as each machine finishes
+} scheduler;
+
+// Scheduler setup functions
+void schedInit(scheduler* s, unsigned int quantum);
+void schedInitContext(context* c, prog_image* img, int priority);
+void schedAdd(scheduler* s, context* c);
+
+// Machine control functions
+void schedSuspend(context* c);
+void schedResume(scheduler* s, context* c);
+
+// Scheduler run functions
+bool schedStep(scheduler* s);
+void schedRun(scheduler* s);
+
+#endif /* SCHEDULER_H_ */